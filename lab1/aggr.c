@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aggr.h"
+
+// header of every packed message
+typedef struct {
+    int type;
+    int size;
+} aggr_header;
+
+
+void aggr_init(aggr *a, MPI_Comm comm, int tag, int capacity, int max_messages, double timeout) {
+    a->comm = comm;
+    a->tag = tag;
+    MPI_Comm_size(comm, &a->n_ranks);
+
+    a->capacity = capacity;
+    a->max_messages = max_messages;
+    a->timeout = timeout;
+
+    a->buffers = malloc(a->n_ranks * sizeof(aggr_buffer));
+    for (int i = 0; i < a->n_ranks; i++) {
+        aggr_buffer *b = &a->buffers[i];
+        b->data[0] = malloc(capacity);
+        b->data[1] = malloc(capacity);
+        b->requests[0] = b->requests[1] = MPI_REQUEST_NULL;
+        b->current = 0;
+        b->used = 0;
+        b->count = 0;
+        b->first_time = 0.0;
+    }
+
+    a->recv_capacity = capacity;
+    a->recv_buffer = malloc(capacity);
+
+    a->pending = NULL;
+    a->n_pending = 0;
+    a->pending_capacity = 0;
+
+    for (int i = 0; i < AGGR_MAX_TYPES; i++) {
+        a->handlers[i] = NULL;
+        a->contexts[i] = NULL;
+    }
+}
+
+
+static void check_type(aggr *a, int type) {
+    if (type < 0 || type >= AGGR_MAX_TYPES) {
+        fprintf(stderr, "aggr: message type %d out of range [0, %d)\n", type, AGGR_MAX_TYPES);
+        MPI_Abort(a->comm, 1);
+    }
+}
+
+
+// unpack buffer and call handler of every message, returns number of messages
+static int dispatch(aggr *a, const char *data, int size, int source) {
+    int dispatched = 0;
+    int offset = 0;
+
+    while (offset < size) {
+        aggr_header header;
+        if (offset + (int) sizeof(aggr_header) > size) {
+            fprintf(stderr, "aggr: truncated message header at byte %d of %d from rank %d\n", offset, size, source);
+            MPI_Abort(a->comm, 1);
+        }
+        memcpy(&header, data + offset, sizeof(aggr_header));
+        offset += sizeof(aggr_header);
+
+        check_type(a, header.type);
+        if (header.size < 0 || header.size > size - offset) {
+            fprintf(stderr, "aggr: message of %d bytes exceeds buffer of %d bytes from rank %d\n", header.size, size, source);
+            MPI_Abort(a->comm, 1);
+        }
+        if (a->handlers[header.type] != NULL) {
+            a->handlers[header.type](source, header.type, data + offset, header.size, a->contexts[header.type]);
+        }
+
+        offset += header.size;
+        dispatched++;
+    }
+
+    return dispatched;
+}
+
+
+// dispatch queued buffers in order of arrival (handlers may queue more of them meanwhile)
+static int dispatch_pending(aggr *a) {
+    int dispatched = 0;
+    for (int i = 0; i < a->n_pending; i++) {
+        dispatched += dispatch(a, a->pending[i].data, a->pending[i].size, a->pending[i].source);
+        free(a->pending[i].data);
+    }
+    a->n_pending = 0;
+
+    return dispatched;
+}
+
+
+/*
+    Receive all incoming buffers - dispatch them right away, or queue them for aggr_poll.
+    Once a buffer is queued (e.g. by a flush inside a handler), following buffers are queued behind it,
+    so buffers of one source are dispatched in the order they were sent.
+*/
+static int receive(aggr *a, int dispatch_now) {
+    int dispatched = 0;
+    int flag;
+    MPI_Status status;
+
+    MPI_Iprobe(MPI_ANY_SOURCE, a->tag, a->comm, &flag, &status);
+    while (flag) {
+        int bytes;
+        MPI_Get_count(&status, MPI_BYTE, &bytes);
+
+        if (dispatch_now && a->n_pending == 0) {
+            if (bytes > a->recv_capacity) {
+                a->recv_capacity = bytes;
+                a->recv_buffer = realloc(a->recv_buffer, bytes);
+            }
+
+            MPI_Recv(a->recv_buffer, bytes, MPI_BYTE, status.MPI_SOURCE, a->tag, a->comm, MPI_STATUS_IGNORE);
+            dispatched += dispatch(a, a->recv_buffer, bytes, status.MPI_SOURCE);
+        } else {
+            if (a->n_pending == a->pending_capacity) {
+                a->pending_capacity = a->pending_capacity ? 2 * a->pending_capacity : 4;
+                a->pending = realloc(a->pending, a->pending_capacity * sizeof(aggr_pending));
+            }
+
+            aggr_pending *p = &a->pending[a->n_pending++];
+            p->data = malloc(bytes);
+            p->size = bytes;
+            p->source = status.MPI_SOURCE;
+            MPI_Recv(p->data, bytes, MPI_BYTE, status.MPI_SOURCE, a->tag, a->comm, MPI_STATUS_IGNORE);
+        }
+
+        MPI_Iprobe(MPI_ANY_SOURCE, a->tag, a->comm, &flag, &status);
+    }
+
+    return dispatched;
+}
+
+
+void aggr_register(aggr *a, int type, aggr_handler handler, void *context) {
+    check_type(a, type);
+    a->handlers[type] = handler;
+    a->contexts[type] = context;
+}
+
+
+void aggr_flush(aggr *a, int dest) {
+    aggr_buffer *b = &a->buffers[dest];
+    if (b->count == 0) return;
+
+    MPI_Isend(b->data[b->current], b->used, MPI_BYTE, dest, a->tag, a->comm, &b->requests[b->current]);
+
+    // switch to the other buffer (its previous send must be finished before it is filled again)
+    b->current = 1 - b->current;
+
+    // receive meanwhile - peer may be waiting for us to match its (rendezvous) send before it can match ours
+    int done;
+    MPI_Test(&b->requests[b->current], &done, MPI_STATUS_IGNORE);
+    while (!done) {
+        receive(a, 0);
+        MPI_Test(&b->requests[b->current], &done, MPI_STATUS_IGNORE);
+    }
+
+    b->used = 0;
+    b->count = 0;
+}
+
+
+void aggr_flush_all(aggr *a) {
+    for (int dest = 0; dest < a->n_ranks; dest++) {
+        aggr_flush(a, dest);
+    }
+}
+
+
+void aggr_send(aggr *a, int dest, int type, const void *data, int size) {
+    aggr_buffer *b = &a->buffers[dest];
+    int record_size = sizeof(aggr_header) + size;
+
+    check_type(a, type);
+
+    if (record_size > a->capacity) {
+        fprintf(stderr, "aggr: message of %d bytes does not fit into buffer of %d bytes\n", size, a->capacity);
+        MPI_Abort(a->comm, 1);
+    }
+
+    if (b->used + record_size > a->capacity) {
+        aggr_flush(a, dest);
+    }
+
+    if (b->count == 0) {
+        b->first_time = MPI_Wtime();
+    }
+
+    aggr_header header = {type, size};
+    memcpy(b->data[b->current] + b->used, &header, sizeof(aggr_header));
+    memcpy(b->data[b->current] + b->used + sizeof(aggr_header), data, size);
+
+    b->used += record_size;
+    b->count++;
+
+    if (b->count >= a->max_messages) {
+        aggr_flush(a, dest);
+    }
+}
+
+
+int aggr_poll(aggr *a) {
+    // flush buffers with too old messages
+    double now = MPI_Wtime();
+    for (int dest = 0; dest < a->n_ranks; dest++) {
+        aggr_buffer *b = &a->buffers[dest];
+        if (b->count > 0 && now - b->first_time >= a->timeout) {
+            aggr_flush(a, dest);
+        }
+    }
+
+    // buffers received during flushes first, then new ones (queued behind any buffer a handler's flush received)
+    int dispatched = dispatch_pending(a);
+    dispatched += receive(a, 1);
+    dispatched += dispatch_pending(a);
+
+    return dispatched;
+}
+
+
+void aggr_free(aggr *a) {
+    for (int i = 0; i < a->n_ranks; i++) {
+        aggr_buffer *b = &a->buffers[i];
+        MPI_Waitall(2, b->requests, MPI_STATUSES_IGNORE);
+        free(b->data[0]);
+        free(b->data[1]);
+    }
+
+    free(a->buffers);
+    free(a->recv_buffer);
+
+    for (int i = 0; i < a->n_pending; i++) {
+        free(a->pending[i].data);
+    }
+    free(a->pending);
+}
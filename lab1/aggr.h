@@ -0,0 +1,79 @@
+#ifndef AGGR_H
+#define AGGR_H
+
+#include <mpi.h>
+
+/*
+
+Small message aggregation over MPI point-to-point.
+
+Messages (type + payload) sent to the same destination are packed into one buffer, which is sent as a single
+MPI message when it holds max_messages messages, when the next message would not fit, or when the oldest
+message in it is older than timeout (checked in aggr_poll). Receiver unpacks buffers in aggr_poll and calls
+handler registered for type of each message.
+
+Every destination has two buffers, one can be filled while the other is still being sent (MPI_Isend).
+While a flush waits for the other buffer, incoming buffers are received (so a peer flushing to us is never blocked
+by us) and queued, their messages are dispatched by the next aggr_poll - handlers never run inside aggr_send.
+Buffers from one source are dispatched in the order they were sent (MPI non-overtaking order), also when
+a handler's flush queues some of them.
+
+*/
+
+#define AGGR_MAX_TYPES 16
+
+typedef void (*aggr_handler)(int source, int type, const void *data, int size, void *context);
+
+typedef struct {
+    char *data[2];
+    MPI_Request requests[2];
+    int current;        // buffer being filled
+    int used;           // bytes in current buffer
+    int count;          // messages in current buffer
+    double first_time;  // time of first message in current buffer
+} aggr_buffer;
+
+// received buffer waiting for dispatch
+typedef struct {
+    char *data;
+    int size;
+    int source;
+} aggr_pending;
+
+typedef struct {
+    MPI_Comm comm;
+    int tag;
+    int n_ranks;
+
+    int capacity;       // bytes per buffer
+    int max_messages;
+    double timeout;     // seconds
+
+    aggr_buffer *buffers;   // one per destination
+    char *recv_buffer;
+    int recv_capacity;
+
+    aggr_pending *pending;
+    int n_pending;
+    int pending_capacity;
+
+    aggr_handler handlers[AGGR_MAX_TYPES];
+    void *contexts[AGGR_MAX_TYPES];
+} aggr;
+
+void aggr_init(aggr *a, MPI_Comm comm, int tag, int capacity, int max_messages, double timeout);
+void aggr_register(aggr *a, int type, aggr_handler handler, void *context);
+
+// buffer message for destination (flushes buffer if it is full)
+void aggr_send(aggr *a, int dest, int type, const void *data, int size);
+
+void aggr_flush(aggr *a, int dest);
+void aggr_flush_all(aggr *a);
+
+// flush timed out buffers, receive and dispatch incoming buffers, returns number of dispatched messages
+int aggr_poll(aggr *a);
+
+// wait for pending sends and free buffers
+void aggr_free(aggr *a);
+
+#endif
@@ -3,17 +3,244 @@
 #include <string.h>
 #include <math.h>
 #include <mpi.h>
+#include "aggr.h"
+#include "shm.h"
 
 const int N = 100;
 
 const int N_POWERS = 31;
 
+// aggregation benchmark - message sizes and batch sizes 2^0 - 2^10
+const int N_AGGR_POWERS = 11;
+
+// shared memory ring size (larger messages go through the ring in parts)
+const size_t SHM_CAPACITY = 4 << 20;
+
+#define MSG_PING 0
+#define MSG_PONG 1
+
+typedef struct {
+    aggr *aggregator;
+    long received;
+} pingContext;
+
+// rank 1 - echo every ping back
+void onPing(int source, int type, const void *data, int size, void *context) {
+    pingContext *ctx = context;
+    ctx->received++;
+    aggr_send(ctx->aggregator, source, MSG_PONG, data, size);
+}
+
+// rank 0 - count returned pongs
+void onPong(int source, int type, const void *data, int size, void *context) {
+    pingContext *ctx = context;
+    ctx->received++;
+}
+
+
+/*
+    Ping-pong of batches through aggregation layer - rank 0 sends `batch` messages, rank 1 echoes each of them,
+    rank 0 waits for all echoes. Buffers are flushed when they hold `batch` messages.
+    Prints: message size exponent, batch size, round-trip time of a batch (same as p2p rows), messages per second.
+*/
+void runAggregation(int rank) {
+    for (int exp = 0; exp < N_AGGR_POWERS; exp++) {
+        const int DATA_SIZE = pow(2, exp);
+        void *sendBuffer = malloc(DATA_SIZE);
+        memset(sendBuffer, 0, DATA_SIZE);
+
+        for (int batchExp = 0; batchExp < N_AGGR_POWERS; batchExp++) {
+            const int BATCH = pow(2, batchExp);
+
+            aggr aggregator;
+            aggr_init(&aggregator, MPI_COMM_WORLD, 0, BATCH * (DATA_SIZE + 2 * sizeof(int)), BATCH, 1.0);
+
+            pingContext ctx = {&aggregator, 0};
+            aggr_register(&aggregator, MSG_PING, onPing, &ctx);
+            aggr_register(&aggregator, MSG_PONG, onPong, &ctx);
+
+            // sync processes
+            MPI_Barrier(MPI_COMM_WORLD);
+
+            // start timer
+            double start = MPI_Wtime();
+
+            if (rank == 0) {
+                for (int i = 0; i < N; i++) {
+                    for (int k = 0; k < BATCH; k++) {
+                        aggr_send(&aggregator, 1, MSG_PING, sendBuffer, DATA_SIZE);
+                    }
+
+                    while (ctx.received < (long)(i + 1) * BATCH) {
+                        aggr_poll(&aggregator);
+                    }
+                }
+            } else {
+                while (ctx.received < (long)N * BATCH) {
+                    aggr_poll(&aggregator);
+                }
+            }
+
+            // stop timer
+            double end = MPI_Wtime();
+
+            aggr_free(&aggregator);
+
+            if (rank == 0) {
+                double roundTrip = (end - start) / N;
+                printf("%d, %d, %f, %f\n", exp, BATCH, roundTrip, BATCH / roundTrip);
+                fflush(stdout);
+            }
+        }
+
+        free(sendBuffer);
+    }
+}
+
+// checksum of received zero-copy data is stored here so reading it is not optimised out
+volatile unsigned long shmSink;
+
+// pass size bytes through ring in place (data is produced / consumed directly in shared memory)
+void shmSendZeroCopy(shm_transport *t, int dest, size_t size, int value) {
+    while (size > 0) {
+        size_t chunk;
+        void *dst = shm_acquire_write(t, dest, &chunk);
+        if (chunk > size) chunk = size;
+
+        memset(dst, value, chunk);
+        shm_commit_write(t, dest, chunk);
+        size -= chunk;
+    }
+}
+
+// returns sum of received 8 byte words (and remaining bytes)
+unsigned long shmRecvZeroCopy(shm_transport *t, int source, size_t size) {
+    unsigned long sum = 0;
+
+    while (size > 0) {
+        size_t chunk;
+        const char *src = shm_acquire_read(t, source, &chunk);
+        if (chunk > size) chunk = size;
+
+        size_t i = 0;
+        for (; i + sizeof(unsigned long) <= chunk; i += sizeof(unsigned long)) {
+            unsigned long word;
+            memcpy(&word, src + i, sizeof(unsigned long));
+            sum += word;
+        }
+        for (; i < chunk; i++) sum += (unsigned char) src[i];
+
+        shm_release_read(t, source, chunk);
+        size -= chunk;
+    }
+
+    return sum;
+}
+
+
+/*
+    Ping-pong through shared memory rings between ranks 0 and 1 (must be on the same node).
+    Prints: exponent, time with copy (shm_send / shm_recv), time zero-copy (sender fills ring in place, receiver sums it).
+*/
+void runSharedMemory(int rank) {
+    shm_transport transport;
+    shm_init(&transport, MPI_COMM_WORLD, SHM_CAPACITY);
+
+    // ranks 0 and 1 must be ranks 0 and 1 of node communicator (it is ordered by world rank)
+    int sameNode = rank > 1 || transport.node_rank == rank;
+    int allOnNode;
+    MPI_Allreduce(&sameNode, &allOnNode, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!allOnNode || transport.node_size < 2) {
+        if (rank == 0) printf("Ranks 0 and 1 must run on the same node\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    double timesCopy[N_POWERS];
+    double timesZeroCopy[N_POWERS];
+
+    for (int exp = 0; exp < N_POWERS; exp++) {
+        const size_t DATA_SIZE = pow(2, exp);
+
+        // define buffer
+        void *buffer = malloc(DATA_SIZE);
+        memset(buffer, 0, DATA_SIZE);
+
+        // === copy ===
+        // sync processes
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        // start timer
+        double start = MPI_Wtime();
+
+        for (int i = 0; i < N; i++) {
+            if (rank == 0) {
+                shm_send(&transport, 1, buffer, DATA_SIZE);
+                shm_recv(&transport, 1, buffer, DATA_SIZE);
+            } else if (rank == 1) {
+                shm_recv(&transport, 0, buffer, DATA_SIZE);
+                shm_send(&transport, 0, buffer, DATA_SIZE);
+            }
+        }
+
+        // stop timer
+        double end = MPI_Wtime();
+        timesCopy[exp] = (end - start) / N;
+
+        // === zero-copy ===
+        // sync processes
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        // start timer
+        start = MPI_Wtime();
+
+        for (int i = 0; i < N; i++) {
+            if (rank == 0) {
+                shmSendZeroCopy(&transport, 1, DATA_SIZE, i);
+                shmSink += shmRecvZeroCopy(&transport, 1, DATA_SIZE);
+            } else if (rank == 1) {
+                shmSink += shmRecvZeroCopy(&transport, 0, DATA_SIZE);
+                shmSendZeroCopy(&transport, 0, DATA_SIZE, i);
+            }
+        }
+
+        // stop timer
+        end = MPI_Wtime();
+        timesZeroCopy[exp] = (end - start) / N;
+
+        // free buffer
+        free(buffer);
+    }
+
+    shm_free(&transport);
+
+    if (rank == 0) {
+        for (int exp = 0; exp < N_POWERS; exp++) {
+            printf("%d, %f, %f\n", exp, timesCopy[exp], timesZeroCopy[exp]);
+        }
+    }
+}
+
+
 int main(int argc, char *argv[]) {
     int rank;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+    if (argc > 1 && strcmp(argv[1], "aggr") == 0) {
+        runAggregation(rank);
+
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "shm") == 0) {
+        runSharedMemory(rank);
+
+        MPI_Finalize();
+        return 0;
+    }
+
     double timesBlocking[N_POWERS];
     double timesNonBlocking[N_POWERS];
 
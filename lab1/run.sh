@@ -0,0 +1,18 @@
+#!/bin/bash -l
+#SBATCH --output=/net/people/plgrid/plgidec/lab1.out
+#SBATCH --nodes 1
+#SBATCH --ntasks 2
+#SBATCH --time=01:00:00
+#SBATCH --partition=plgrid-testing
+#SBATCH --account=plgmpr24-cpu
+
+mpicc -O2 -o p2p p2p.c aggr.c shm.c -lm
+
+# exp, blocking, nonblocking
+mpirun -np 2 ./p2p > p2p.csv
+
+# exp, batch, round-trip time of a batch, messages per second
+mpirun -np 2 ./p2p aggr > aggr.csv
+
+# exp, copy, zero-copy (ranks 0 and 1 on the same node)
+mpirun -np 2 ./p2p shm > shm.csv
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "shm.h"
+
+// ring control block followed by data, rounded to cache line
+static size_t ring_bytes(size_t capacity) {
+    size_t bytes = sizeof(shm_ring_ctrl) + capacity;
+    return (bytes + SHM_CACHE_LINE - 1) / SHM_CACHE_LINE * SHM_CACHE_LINE;
+}
+
+
+void shm_init(shm_transport *t, MPI_Comm comm, size_t capacity) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &t->node_comm);
+    MPI_Comm_rank(t->node_comm, &t->node_rank);
+    MPI_Comm_size(t->node_comm, &t->node_size);
+
+    t->capacity = capacity;
+
+    // every process places its incoming rings in its own (NUMA local) part of window
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+
+    char *base;
+    MPI_Win_allocate_shared(t->node_size * ring_bytes(capacity), 1, info, t->node_comm, &base, &t->win);
+    MPI_Info_free(&info);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, t->win);
+
+    t->send_rings = malloc(t->node_size * sizeof(shm_ring));
+    t->recv_rings = malloc(t->node_size * sizeof(shm_ring));
+
+    for (int i = 0; i < t->node_size; i++) {
+        shm_ring *ring = &t->recv_rings[i];
+        ring->ctrl = (shm_ring_ctrl *) (base + i * ring_bytes(capacity));
+        ring->data = (char *) (ring->ctrl + 1);
+        ring->capacity = capacity;
+
+        atomic_init(&ring->ctrl->head, 0);
+        atomic_init(&ring->ctrl->tail, 0);
+    }
+
+    MPI_Win_sync(t->win);
+    MPI_Barrier(t->node_comm);
+    MPI_Win_sync(t->win);
+
+    for (int i = 0; i < t->node_size; i++) {
+        MPI_Aint size;
+        int disp_unit;
+        char *peer_base;
+        MPI_Win_shared_query(t->win, i, &size, &disp_unit, &peer_base);
+
+        shm_ring *ring = &t->send_rings[i];
+        ring->ctrl = (shm_ring_ctrl *) (peer_base + t->node_rank * ring_bytes(capacity));
+        ring->data = (char *) (ring->ctrl + 1);
+        ring->capacity = capacity;
+    }
+}
+
+
+void shm_free(shm_transport *t) {
+    MPI_Barrier(t->node_comm);
+
+    MPI_Win_unlock_all(t->win);
+    MPI_Win_free(&t->win);
+
+    free(t->send_rings);
+    free(t->recv_rings);
+
+    MPI_Comm_free(&t->node_comm);
+}
+
+
+void *shm_acquire_write(shm_transport *t, int dest, size_t *size) {
+    shm_ring *ring = &t->send_rings[dest];
+
+    size_t head = atomic_load_explicit(&ring->ctrl->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->ctrl->tail, memory_order_acquire);
+
+    while (head - tail == ring->capacity) {
+        sched_yield();
+        tail = atomic_load_explicit(&ring->ctrl->tail, memory_order_acquire);
+    }
+
+    size_t offset = head % ring->capacity;
+    size_t free_bytes = ring->capacity - (head - tail);
+    size_t contiguous = ring->capacity - offset;
+
+    *size = free_bytes < contiguous ? free_bytes : contiguous;
+    return ring->data + offset;
+}
+
+
+void shm_commit_write(shm_transport *t, int dest, size_t size) {
+    shm_ring *ring = &t->send_rings[dest];
+    size_t head = atomic_load_explicit(&ring->ctrl->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->ctrl->head, head + size, memory_order_release);
+}
+
+
+const void *shm_acquire_read(shm_transport *t, int source, size_t *size) {
+    shm_ring *ring = &t->recv_rings[source];
+
+    size_t tail = atomic_load_explicit(&ring->ctrl->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->ctrl->head, memory_order_acquire);
+
+    while (head == tail) {
+        sched_yield();
+        head = atomic_load_explicit(&ring->ctrl->head, memory_order_acquire);
+    }
+
+    size_t offset = tail % ring->capacity;
+    size_t available = head - tail;
+    size_t contiguous = ring->capacity - offset;
+
+    *size = available < contiguous ? available : contiguous;
+    return ring->data + offset;
+}
+
+
+void shm_release_read(shm_transport *t, int source, size_t size) {
+    shm_ring *ring = &t->recv_rings[source];
+    size_t tail = atomic_load_explicit(&ring->ctrl->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->ctrl->tail, tail + size, memory_order_release);
+}
+
+
+void shm_send(shm_transport *t, int dest, const void *buf, size_t size) {
+    const char *src = buf;
+
+    while (size > 0) {
+        size_t chunk;
+        void *dst = shm_acquire_write(t, dest, &chunk);
+        if (chunk > size) chunk = size;
+
+        memcpy(dst, src, chunk);
+        shm_commit_write(t, dest, chunk);
+
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+
+void shm_recv(shm_transport *t, int source, void *buf, size_t size) {
+    char *dst = buf;
+
+    while (size > 0) {
+        size_t chunk;
+        const void *src = shm_acquire_read(t, source, &chunk);
+        if (chunk > size) chunk = size;
+
+        memcpy(dst, src, chunk);
+        shm_release_read(t, source, chunk);
+
+        dst += chunk;
+        size -= chunk;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <mpi.h>
+
+/*
+
+Intra-node transport over MPI-3 shared memory window.
+
+Communicator is split with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED), every process of the node allocates its part
+of MPI_Win_allocate_shared window with one incoming ring per process of the node. Ring is single-producer /
+single-consumer byte stream - producer only moves head, consumer only moves tail (C11 atomics, acquire / release).
+
+shm_send / shm_recv copy through the ring (messages larger than ring are sent in parts). Zero-copy access:
+shm_acquire_write returns free contiguous part of the ring for data to be produced in place, shm_commit_write
+publishes it; shm_acquire_read / shm_release_read do the same on the consumer side.
+
+Ranks in all functions are ranks in node communicator (shm_transport.node_rank).
+
+Memory: every process holds a ring for every process of the node, node_size^2 * capacity bytes per node in total
+(48 processes with 4 MiB rings - 9 GiB), whether the pairs communicate or not. Transport is meant for a few
+communicating pairs on a node with few processes (p2p benchmark uses ranks 0 and 1) - with many processes per node
+use a small capacity (large messages go through the ring in parts anyway).
+
+*/
+
+#define SHM_CACHE_LINE 64
+
+typedef struct {
+    _Atomic size_t head;    // bytes written so far (producer)
+    char pad0[SHM_CACHE_LINE - sizeof(size_t)];
+    _Atomic size_t tail;    // bytes read so far (consumer)
+    char pad1[SHM_CACHE_LINE - sizeof(size_t)];
+} shm_ring_ctrl;
+
+typedef struct {
+    shm_ring_ctrl *ctrl;
+    char *data;
+    size_t capacity;
+} shm_ring;
+
+typedef struct {
+    MPI_Comm node_comm;
+    int node_rank;
+    int node_size;
+
+    MPI_Win win;
+    size_t capacity;
+
+    shm_ring *send_rings;   // send_rings[i] - ring in memory of process i, written by this process
+    shm_ring *recv_rings;   // recv_rings[i] - ring in memory of this process, written by process i
+} shm_transport;
+
+// collective over comm, allocates node_size rings of capacity bytes in every process
+void shm_init(shm_transport *t, MPI_Comm comm, size_t capacity);
+void shm_free(shm_transport *t);
+
+void shm_send(shm_transport *t, int dest, const void *buf, size_t size);
+void shm_recv(shm_transport *t, int source, void *buf, size_t size);
+
+// wait for free space in ring to dest, returns pointer to it and its contiguous size in *size
+void *shm_acquire_write(shm_transport *t, int dest, size_t *size);
+void shm_commit_write(shm_transport *t, int dest, size_t size);
+
+// wait for data in ring from source, returns pointer to it and its contiguous size in *size
+const void *shm_acquire_read(shm_transport *t, int source, size_t *size);
+void shm_release_read(shm_transport *t, int source, size_t size);
+
+#endif
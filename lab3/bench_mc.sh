@@ -0,0 +1,22 @@
+#!/bin/bash -l
+#SBATCH --output=/net/people/plgrid/plgidec/lab3_mc.out
+#SBATCH --nodes 1
+#SBATCH --ntasks 12
+#SBATCH --time=01:00:00
+#SBATCH --partition=plgrid-testing
+#SBATCH --account=plgmpr24-cpu
+
+mpicxx -O2 -o mc_pi mc_pi.cpp
+
+sizes=(1000000 140712473 1688549676)
+
+# 0 - mc_integrate, 1 - mc_integrate stratified, 2 - hand-written loop
+for mode in 0 1 2; do
+    echo "size,processes,time,estimate,std_error" > ./results/mc_mode_${mode}.csv
+    for size in "${sizes[@]}"; do
+        for proc_i in {1..12}; do
+            echo "mode=$mode, size=$size, proc_i=$proc_i"
+            mpirun -np $proc_i ./mc_pi $size $mode >> ./results/mc_mode_${mode}.csv
+        done
+    done
+done
@@ -1,19 +1,168 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <mpi.h>
 
 const double PI = 3.14159265358979323846;
 
+// samplers
+#define SAMPLER_RAND 0
+#define SAMPLER_HALTON 1
+#define SAMPLER_SOBOL 2
+
+// number of independent random shifts of the quasi-random sequence (error is estimated from their spread)
+#define N_SHIFTS 8
+
+// 97.5% quantile of Student's t distribution with N_SHIFTS - 1 degrees of freedom
+const double T_QUANTILE = 2.364624;
+
+// 97.5% quantile of normal distribution
+const double Z_QUANTILE = 1.959964;
+
+// points per process between two convergence checks - starts at FIRST_BATCH and doubles after every check up to BATCH
+// (same on every process, so leapfrogged points still form a prefix of the sequence)
+const long FIRST_BATCH = 1 << 10;
+const long BATCH = 1 << 20;
+
 // random double between -1 and 1
 double randOneToOne(){
     return (double)rand() / RAND_MAX * 2.0 - 1.0;
 }
 
+// splitmix64 - used only to derive shifts, so every process gets the same ones
+uint64_t splitmix64(uint64_t *state){
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t reverseBits(uint64_t v){
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    v = ((v >> 8) & 0x00FF00FF00FF00FFULL) | ((v & 0x00FF00FF00FF00FFULL) << 8);
+    v = ((v >> 16) & 0x0000FFFF0000FFFFULL) | ((v & 0x0000FFFF0000FFFFULL) << 16);
+    return (v >> 32) | (v << 32);
+}
+
+// van der Corput sequence in base 3
+double radicalInverse3(uint64_t i){
+    double result = 0.0;
+    double f = 1.0 / 3.0;
+    while (i > 0){
+        result += f * (double)(i % 3);
+        i /= 3;
+        f /= 3.0;
+    }
+    return result;
+}
+
+// second dimension of Sobol sequence (primitive polynomial x + 1), first one is van der Corput in base 2
+uint64_t sobolDirections[64];
+
+void initSobol(){
+    sobolDirections[0] = 1ULL << 63;
+    for (int k = 1; k < 64; k++)
+        sobolDirections[k] = sobolDirections[k - 1] ^ (sobolDirections[k - 1] >> 1);
+}
+
+uint64_t sobol2(uint64_t i){
+    uint64_t result = 0;
+    for (int k = 0; i > 0; k++, i >>= 1){
+        if (i & 1) result ^= sobolDirections[k];
+    }
+    return result;
+}
+
+/*
+    Counts points inside the circle for `count` consecutive points of the current process.
+    Quasi-random points are leapfrogged - point `i` of process `rank` is point `i * size + rank` of the sequence,
+    so as long as every process takes the same number of points all of them together use a prefix of the sequence.
+    Each point is evaluated once per shift (Cranley-Patterson rotation for Halton, digital shift for Sobol).
+*/
+void samplePoints(int sampler, int rank, int size, long first, long count,
+                  const double shifts[][2], const uint64_t masks[][2], long *hits){
+    if (sampler == SAMPLER_RAND){
+        for (long i = 0; i < count; i++){
+            double x = randOneToOne();
+            double y = randOneToOne();
+
+            if ((x*x + y*y) <= 1) hits[0]++;
+        }
+        return;
+    }
+
+    for (long i = first; i < first + count; i++){
+        uint64_t index = (uint64_t)i * size + rank;
+
+        if (sampler == SAMPLER_HALTON){
+            // skip point 0 of Halton sequence (0, 0)
+            double u = reverseBits(index + 1) * 0x1p-64;
+            double v = radicalInverse3(index + 1);
+
+            for (int s = 0; s < N_SHIFTS; s++){
+                double x = u + shifts[s][0];
+                double y = v + shifts[s][1];
+                if (x >= 1.0) x -= 1.0;
+                if (y >= 1.0) y -= 1.0;
+
+                x = x * 2.0 - 1.0;
+                y = y * 2.0 - 1.0;
+                if ((x*x + y*y) <= 1) hits[s]++;
+            }
+        } else {
+            uint64_t u = reverseBits(index);
+            uint64_t v = sobol2(index);
+
+            for (int s = 0; s < N_SHIFTS; s++){
+                double x = (double)((u ^ masks[s][0]) >> 11) * 0x1p-53 * 2.0 - 1.0;
+                double y = (double)((v ^ masks[s][1]) >> 11) * 0x1p-53 * 2.0 - 1.0;
+                if ((x*x + y*y) <= 1) hits[s]++;
+            }
+        }
+    }
+}
+
+// estimate of pi and half width of its 95% confidence interval from reduced counters (hits per shift, points)
+double estimatePi(int sampler, const long *counters, double *half_width){
+    long points = counters[N_SHIFTS];
+
+    if (sampler == SAMPLER_RAND){
+        double p = (double)counters[0] / points;
+        *half_width = Z_QUANTILE * 4.0 * sqrt(p * (1.0 - p) / points);
+        return 4.0 * p;
+    }
+
+    double mean = 0.0;
+    for (int s = 0; s < N_SHIFTS; s++)
+        mean += 4.0 * counters[s] / points;
+    mean /= N_SHIFTS;
+
+    double var = 0.0;
+    for (int s = 0; s < N_SHIFTS; s++){
+        double d = 4.0 * counters[s] / points - mean;
+        var += d * d;
+    }
+    var /= N_SHIFTS - 1;
+
+    *half_width = T_QUANTILE * sqrt(var / N_SHIFTS);
+    return mean;
+}
+
 
 int main(int argc, char *argv[]) {
-    long N = atol(argv[1]);   
-    
+    if (argc < 2){
+        printf("Usage: %s <N> [target_error] [sampler: 0 - rand, 1 - Halton, 2 - Sobol]\n", argv[0]);
+        exit(1);
+    }
+
+    long N = atol(argv[1]);
+    double target_error = argc > 2 ? atof(argv[2]) : 0.0;
+    int sampler = argc > 3 ? atoi(argv[3]) : SAMPLER_RAND;
+
     int rank, size;
 
     MPI_Init(&argc, &argv);
@@ -22,36 +171,124 @@ int main(int argc, char *argv[]) {
 
     srand(rank);
 
-    // calculate iteration for current process (last process may have more iterations if N is not divisible by size)
-    long K = N / size;
-    if (rank == size - 1) K += N % size;
+    if (target_error <= 0.0 && sampler == SAMPLER_RAND){
+        // calculate iteration for current process (last process may have more iterations if N is not divisible by size)
+        long K = N / size;
+        if (rank == size - 1) K += N % size;
+
+        // double barrier start time to ensure all processes start calculation at the same time
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        double start_time = MPI_Wtime();
+
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        long sum = 0;
+        for (long i = 0; i < K; i++){
+            double x = randOneToOne();
+            double y = randOneToOne();
+
+            if ((x*x + y*y) <= 1) sum++;
+        }
+
+        long global_sum;
+        MPI_Reduce(&sum, &global_sum, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        double end_time = MPI_Wtime();
+
+        if (rank == 0){
+            printf("%ld, %d, %f\n", N, size, end_time - start_time);
+            fflush(stdout);
+        }
+
+        MPI_Finalize();
+        return 0;
+    }
+
+    // --- time to accuracy mode ---
+    // N is the upper limit of points, every process takes the same number of points (leapfrogging needs it)
+    long limit = N / size;
+    if (limit < 1){
+        if (rank == 0) printf("N must be at least the number of processes (%d)\n", size);
+        MPI_Finalize();
+        exit(1);
+    }
+
+    // same shifts on every process
+    double shifts[N_SHIFTS][2];
+    uint64_t masks[N_SHIFTS][2];
+    uint64_t seed = 2024;
+    for (int s = 0; s < N_SHIFTS; s++){
+        masks[s][0] = splitmix64(&seed);
+        masks[s][1] = splitmix64(&seed);
+        shifts[s][0] = (masks[s][0] >> 11) * 0x1p-53;
+        shifts[s][1] = (masks[s][1] >> 11) * 0x1p-53;
+    }
+    initSobol();
+
+    // hits per shift and number of points
+    long counters[N_SHIFTS + 1] = {0};
+    long sent[N_SHIFTS + 1];
+    long global[N_SHIFTS + 1];
+
+    MPI_Request request = MPI_REQUEST_NULL;
+    int converged = 0;
+    long batch = target_error > 0.0 ? FIRST_BATCH : BATCH;
 
     // double barrier start time to ensure all processes start calculation at the same time
     MPI_Barrier(MPI_COMM_WORLD);
 
     double start_time = MPI_Wtime();
-   
+
     MPI_Barrier(MPI_COMM_WORLD);
 
-    long sum = 0;
-    for (long i = 0; i < K; i++){
-        double x = randOneToOne();
-        double y = randOneToOne();
+    /*
+        Convergence is checked on the previous batch - its reduction runs in the background while the next batch
+        is sampled. Every process gets the same reduced counters, so all of them stop after the same batch.
+    */
+    while (!converged && counters[N_SHIFTS] < limit){
+        long count = limit - counters[N_SHIFTS];
+        if (count > batch) count = batch;
+        if (batch < BATCH) batch *= 2;
 
-        if ((x*x + y*y) <= 1) sum++;
+        samplePoints(sampler, rank, size, counters[N_SHIFTS], count, shifts, masks, counters);
+        counters[N_SHIFTS] += count;
+
+        if (target_error <= 0.0) continue;
+
+        if (request != MPI_REQUEST_NULL){
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+
+            double half_width;
+            estimatePi(sampler, global, &half_width);
+            converged = half_width <= target_error;
+        }
+
+        if (!converged){
+            memcpy(sent, counters, sizeof(counters));
+            MPI_Iallreduce(sent, global, N_SHIFTS + 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD, &request);
+        }
     }
 
-    long global_sum;
-    MPI_Reduce(&sum, &global_sum, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (request != MPI_REQUEST_NULL)
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+
+    // final estimate uses every sampled point, including the batch sampled during the last check
+    MPI_Reduce(counters, global, N_SHIFTS + 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
     double end_time = MPI_Wtime();
 
     if (rank == 0){
-        printf("%ld, %d, %f\n", N, size, end_time - start_time);
+        double half_width;
+        double estimate = estimatePi(sampler, global, &half_width);
+
+        // points, processes, time, estimate, half width of 95% confidence interval, actual error
+        printf("%ld, %d, %f, %.15f, %e, %e\n", global[N_SHIFTS], size, end_time - start_time,
+               estimate, half_width, fabs(estimate - PI));
         fflush(stdout);
     }
 
 
     MPI_Finalize();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+#ifndef MC_INTEGRATE_HPP
+#define MC_INTEGRATE_HPP
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+
+/*
+
+Monte Carlo integration engine.
+
+mc_integrate<Dim>(f, lo, hi, N, strata) integrates f over box [lo, hi] (Dim dimensions) with N samples split
+between processes the same way as in lab3 (last process takes the remainder) and reduced to process 0.
+
+- Dim is known at compile time, so the sample vector is a plain array the compiler keeps in registers
+  and f (any callable taking `const double *`) is inlined into the sampling loop.
+- strata > 1 enables stratified sampling - the box is split into strata^Dim equal cells and samples
+  are assigned to cells round robin (by global sample index), so every cell gets N / strata^Dim samples (+1).
+  If N < 2 * strata^Dim (some cell would get less than 2 samples, too few for its variance), plain sampling is used.
+
+*/
+
+
+// xorshift64* - small enough to be inlined into the sampling loop (rand() is a locked libc call)
+struct mc_rng {
+    uint64_t state;
+
+    explicit mc_rng(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+    // random double in [0, 1)
+    inline double next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (double)((state * 0x2545F4914F6CDD1DULL) >> 11) * 0x1p-53;
+    }
+};
+
+
+struct mc_result {
+    double estimate;    // valid on process 0 only
+    double std_error;   // valid on process 0 only
+    long samples;
+};
+
+
+template <int Dim, typename Integrand>
+mc_result mc_integrate(Integrand f, const double (&lo)[Dim], const double (&hi)[Dim], long N, int strata = 1,
+                       MPI_Comm comm = MPI_COMM_WORLD) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // calculate iteration for current process (last process may have more iterations if N is not divisible by size)
+    long K = N / size;
+    long first = rank * K;
+    if (rank == size - 1) K += N % size;
+
+    double width[Dim];
+    double volume = 1.0;
+    for (int d = 0; d < Dim; d++) {
+        width[d] = hi[d] - lo[d];
+        volume *= width[d];
+    }
+
+    mc_rng rng(rank);
+    mc_result result;
+    result.samples = N;
+
+    // number of cells, stratification is dropped when some cell would get less than 2 samples (keeps cells from overflow too)
+    long cells = 1;
+    for (int d = 0; d < Dim && strata > 1; d++) {
+        if (cells > N / 2 / strata) strata = 1;
+        else cells *= strata;
+    }
+
+    if (strata <= 1) {
+        // sum of f, sum of f^2
+        double local[2] = {0.0, 0.0};
+        double global[2] = {0.0, 0.0};
+
+        for (long i = 0; i < K; i++) {
+            double x[Dim];
+            for (int d = 0; d < Dim; d++)
+                x[d] = lo[d] + rng.next() * width[d];
+
+            double v = f(x);
+            local[0] += v;
+            local[1] += v * v;
+        }
+
+        MPI_Reduce(local, global, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+        double mean = global[0] / N;
+        double var = global[1] / N - mean * mean;
+        result.estimate = volume * mean;
+        result.std_error = volume * sqrt(var / N);
+        return result;
+    }
+
+    double cell_width[Dim];
+    for (int d = 0; d < Dim; d++)
+        cell_width[d] = width[d] / strata;
+
+    // per cell: sum of f, sum of f^2, number of samples
+    std::vector<double> local(3 * cells, 0.0);
+    std::vector<double> global(rank == 0 ? 3 * cells : 0);
+
+    // cell of the first sample as digits in base strata (odometer, first dimension is the fastest one)
+    long cell = first % cells;
+    int digit[Dim];
+    long rest = cell;
+    for (int d = 0; d < Dim; d++) {
+        digit[d] = rest % strata;
+        rest /= strata;
+    }
+
+    for (long i = 0; i < K; i++) {
+        double x[Dim];
+        for (int d = 0; d < Dim; d++)
+            x[d] = lo[d] + (digit[d] + rng.next()) * cell_width[d];
+
+        double v = f(x);
+        local[3 * cell] += v;
+        local[3 * cell + 1] += v * v;
+        local[3 * cell + 2] += 1.0;
+
+        // next cell
+        if (++cell == cells) cell = 0;
+        for (int d = 0; d < Dim && ++digit[d] == strata; d++)
+            digit[d] = 0;
+    }
+
+    MPI_Reduce(local.data(), global.data(), 3 * cells, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+    result.estimate = 0.0;
+    result.std_error = 0.0;
+
+    if (rank == 0) {
+        // every cell has volume / cells, estimate is sum of cell means, variance is sum of variances of cell means
+        double var = 0.0;
+        for (long c = 0; c < cells; c++) {
+            double n = global[3 * c + 2];
+            if (n == 0) continue;
+
+            double mean = global[3 * c] / n;
+            result.estimate += mean;
+            var += (global[3 * c + 1] / n - mean * mean) / n;
+        }
+
+        result.estimate *= volume / cells;
+        result.std_error = volume / cells * sqrt(var);
+    }
+
+    return result;
+}
+
+#endif
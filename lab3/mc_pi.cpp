@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <mpi.h>
+#include "mc_integrate.hpp"
+
+/*
+
+Pi estimator as an instantiation of mc_integrate (integral of unit disc indicator over [-1, 1]^2).
+
+Modes:
+0) mc_integrate<2> - plain sampling.
+1) mc_integrate<2> - stratified sampling (strata per dimension from third parameter).
+2) hand-written loop with the same generator and decomposition - reference for throughput of the engine.
+
+*/
+
+
+#define MODE_ENGINE 0
+#define MODE_STRATIFIED 1
+#define MODE_HAND_WRITTEN 2
+
+
+struct unit_disc {
+    inline double operator()(const double *x) const {
+        return (x[0]*x[0] + x[1]*x[1]) <= 1 ? 1.0 : 0.0;
+    }
+};
+
+
+long hand_written(long N, int rank, int size) {
+    long K = N / size;
+    if (rank == size - 1) K += N % size;
+
+    mc_rng rng(rank);
+
+    long sum = 0;
+    for (long i = 0; i < K; i++){
+        double x = rng.next() * 2.0 - 1.0;
+        double y = rng.next() * 2.0 - 1.0;
+
+        // branchless like the engine's accumulation of f (a branch on random points mispredicts half the time)
+        sum += (x*x + y*y) <= 1;
+    }
+
+    long global_sum = 0;
+    MPI_Reduce(&sum, &global_sum, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    return global_sum;
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2){
+        printf("Usage: %s <N> [mode: 0 - engine, 1 - stratified, 2 - hand-written] [strata]\n", argv[0]);
+        exit(1);
+    }
+
+    long N = atol(argv[1]);
+    int mode = argc > 2 ? atoi(argv[2]) : MODE_ENGINE;
+    int strata = argc > 3 ? atoi(argv[3]) : 16;
+
+    int rank, size;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const double lo[2] = {-1.0, -1.0};
+    const double hi[2] = {1.0, 1.0};
+
+    // double barrier start time to ensure all processes start calculation at the same time
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    double start_time = MPI_Wtime();
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    double estimate, std_error;
+
+    if (mode == MODE_HAND_WRITTEN) {
+        estimate = 4.0 * hand_written(N, rank, size) / N;
+        std_error = 4.0 * sqrt(estimate / 4.0 * (1.0 - estimate / 4.0) / N);
+    } else {
+        mc_result result = mc_integrate<2>(unit_disc(), lo, hi, N, mode == MODE_STRATIFIED ? strata : 1);
+        estimate = result.estimate;
+        std_error = result.std_error;
+    }
+
+    double end_time = MPI_Wtime();
+
+    if (rank == 0){
+        printf("%ld, %d, %f, %.10f, %e\n", N, size, end_time - start_time, estimate, std_error);
+        fflush(stdout);
+    }
+
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/bash -l
+#SBATCH --output=/net/people/plgrid/plgidec/lab3_accuracy.out
+#SBATCH --nodes 1
+#SBATCH --ntasks 12
+#SBATCH --time=01:00:00
+#SBATCH --partition=plgrid-testing
+#SBATCH --account=plgmpr24-cpu
+
+mpicc -O2 -o lab3 lab3.c -lm
+
+# upper limit of points - same as big problem
+limit=19800000000
+targets=(1e-3 1e-4 1e-5 1e-6)
+
+# 0 - rand, 1 - Halton, 2 - Sobol
+for sampler in 0 1 2; do
+    echo "points,processes,time,estimate,half_width,error" > ./results/accuracy_${sampler}.csv
+    for target in "${targets[@]}"; do
+        for proc_i in {1..12}; do
+            echo "sampler=$sampler, target=$target, proc_i=$proc_i"
+            mpirun -np $proc_i ./lab3 $limit $target $sampler >> ./results/accuracy_${sampler}.csv
+        done
+    done
+done
@@ -54,7 +54,14 @@ int main(int argc, char *argv[]) {
 
     double end_time = omp_get_wtime();
 
-    printf("%f\n",  end_time - start_time);
+    // bandwidth of fill (4 B written per element) and its fraction of peak given in GB/s by PEAK_BW (../lab4/stream)
+    const char *peak_bw = getenv("PEAK_BW");
+    if (peak_bw != NULL) {
+        double bandwidth = size * sizeof(int) / (end_time - start_time) / 1e9;
+        printf("%f,%f,%f\n", end_time - start_time, bandwidth, bandwidth / atof(peak_bw));
+    } else {
+        printf("%f\n",  end_time - start_time);
+    }
 
     free(a);
 
@@ -1,6 +1,14 @@
 #!/bin/bash
 
-echo "size,schedule,chunk,threads,time" > "output.csv"
+echo "size,schedule,chunk,threads,time,bandwidth,peak_fraction" > "output.csv"
+
+# peak bandwidth (best of STREAM triad with regular and non-temporal stores) for every number of threads, all probe results go to stream.csv
+gcc -O2 -march=native stream.c -o stream -fopenmp
+echo "threads,copy,scale,triad,copy_nt,scale_nt,triad_nt,gflops,flops_per_cycle" > "stream.csv"
+declare -A peak_bw
+for threads in 1 2 4 8 16 32 64; do
+    peak_bw[$threads]=$(./stream 20000000 $threads | tee -a "stream.csv" | awk -F, '{ print ($4 > $7 ? $4 : $7) }')
+done
 
 for size in 0 2 4 6 7 8 9; do
     actual_size=$((10**$size))
@@ -10,7 +18,7 @@ for size in 0 2 4 6 7 8 9; do
             for threads in 1 2 4 8 16 32 64; do
                 echo "run for" $actual_size "size, " $chunk_size "chunk size, " $schedule_type "schedule type and " $threads "threads"
                 gcc -Wall rand.c -o rand -fopenmp -DCHUNKSIZE=$chunk_size -DPADDING=0
-                printf "%d,%d,%d,%d,%f\n" $actual_size $schedule_type $chunk_size $threads $(OMP_NUM_THREADS=$threads OMP_DYNAMIC=false ./rand $actual_size $chunk_size $schedule_type) >> "output.csv";
+                printf "%d,%d,%d,%d,%s\n" $actual_size $schedule_type $chunk_size $threads $(PEAK_BW=${peak_bw[$threads]} OMP_NUM_THREADS=$threads OMP_DYNAMIC=false ./rand $actual_size $chunk_size $schedule_type) >> "output.csv";
             done
         done
     done
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+/*
+
+Machine limits for given number of threads.
+
+1) STREAM kernels (copy: c = a, scale: b = s * c, triad: a = b + s * c) on arrays of <size> doubles,
+   with regular and with non-temporal stores. Best of NTIMES runs, bytes counted as in STREAM
+   (16 B per element for copy and scale, 24 B for triad, no write allocate).
+2) Peak FLOP - every thread runs CHAINS independent chains of 4-wide fused multiply-adds.
+   Reported also per TSC cycle of one thread (TSC ticks at nominal frequency, not core clock).
+
+Output: threads,copy,scale,triad,copy_nt,scale_nt,triad_nt,gflops,flops_per_cycle (bandwidth in GB/s).
+
+*/
+
+#define NTIMES 10
+
+#define CHAINS 8     // independent accumulators x0 - x7 in FLOP loop
+#define FLOP_ITERATIONS 10000000
+
+typedef double v4d __attribute__((vector_size(32)));
+
+// result of FLOP loop is stored here so it is not optimised out
+volatile double flop_sink;
+
+
+// part of array [begin, end) of current thread, begin aligned to 8 doubles (64 B)
+void thread_range(long size, long *begin, long *end) {
+    int tid = omp_get_thread_num();
+    int threads = omp_get_num_threads();
+
+    long chunk = size / threads / 8 * 8;
+    *begin = tid * chunk;
+    *end = tid == threads - 1 ? size : *begin + chunk;
+}
+
+
+// store 4 doubles bypassing cache (dst aligned to 32 B)
+static inline void stream_store(double *dst, v4d value) {
+#ifdef __AVX__
+    _mm256_stream_pd(dst, (__m256d) value);
+#else
+    *(v4d *) dst = value;
+#endif
+}
+
+
+double run_kernel(int kernel, int nontemporal, double *a, double *b, double *c, long size) {
+    const double scalar = 3.0;
+    double best = 0.0;
+
+    for (int k = 0; k < NTIMES; k++) {
+        double start_time = omp_get_wtime();
+
+        #pragma omp parallel shared(a, b, c, size)
+        {
+            long begin, end;
+            thread_range(size, &begin, &end);
+
+            long i = begin;
+
+            // non-temporal stores for aligned 4 double blocks, the rest with regular stores
+            if (nontemporal) {
+                switch (kernel) {
+                    case 0:
+                        for (; i + 4 <= end; i += 4) stream_store(c + i, *(v4d *) (a + i));
+                        break;
+                    case 1:
+                        for (; i + 4 <= end; i += 4) stream_store(b + i, scalar * *(v4d *) (c + i));
+                        break;
+                    default:
+                        for (; i + 4 <= end; i += 4) stream_store(a + i, *(v4d *) (b + i) + scalar * *(v4d *) (c + i));
+                        break;
+                }
+            }
+
+            switch (kernel) {
+                case 0:
+                    for (; i < end; i++) c[i] = a[i];
+                    break;
+                case 1:
+                    for (; i < end; i++) b[i] = scalar * c[i];
+                    break;
+                default:
+                    for (; i < end; i++) a[i] = b[i] + scalar * c[i];
+                    break;
+            }
+
+#ifdef __AVX__
+            _mm_sfence();
+#endif
+        }
+
+        double time = omp_get_wtime() - start_time;
+        if (k == 0 || time < best) best = time;
+    }
+
+    double bytes = (kernel == 2 ? 24.0 : 16.0) * size;
+    return bytes / best / 1e9;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    if (argc != 3) {
+        printf("Usage: %s <size> <threads>\n", argv[0]);
+        exit(1);
+    }
+
+    long size = atol(argv[1]);
+    int num_threads = atoi(argv[2]);
+
+    omp_set_num_threads(num_threads);
+
+    double *a, *b, *c;
+    if (posix_memalign((void **) &a, 64, size * sizeof(double)) != 0 ||
+        posix_memalign((void **) &b, 64, size * sizeof(double)) != 0 ||
+        posix_memalign((void **) &c, 64, size * sizeof(double)) != 0) {
+        printf("Failed to allocate arrays\n");
+        exit(1);
+    }
+
+    // first touch by the same threads that run kernels
+    #pragma omp parallel shared(a, b, c, size)
+    {
+        long begin, end;
+        thread_range(size, &begin, &end);
+
+        for (long i = begin; i < end; i++) {
+            a[i] = 1.0;
+            b[i] = 2.0;
+            c[i] = 0.0;
+        }
+    }
+
+    // --- bandwidth ---
+    double bandwidth[6];
+    for (int nontemporal = 0; nontemporal < 2; nontemporal++) {
+        for (int kernel = 0; kernel < 3; kernel++) {
+            bandwidth[nontemporal * 3 + kernel] = run_kernel(kernel, nontemporal, a, b, c, size);
+        }
+    }
+
+    // --- peak FLOP ---
+    double flop_start_time = omp_get_wtime();
+    unsigned long long tsc_start = __rdtsc();
+    double checksum = 0.0;
+
+    #pragma omp parallel reduction(+:checksum)
+    {
+        // named accumulators (not an array) so every chain stays in its own register
+        const v4d one = {1.0, 1.0, 1.0, 1.0};
+        double tid = omp_get_thread_num();
+        v4d x0 = one * tid, x1 = one * (tid + 1), x2 = one * (tid + 2), x3 = one * (tid + 3);
+        v4d x4 = one * (tid + 4), x5 = one * (tid + 5), x6 = one * (tid + 6), x7 = one * (tid + 7);
+
+        const v4d mul = {0.999999, 0.999999, 0.999999, 0.999999};
+        const v4d add = {1e-7, 1e-7, 1e-7, 1e-7};
+
+        for (long i = 0; i < FLOP_ITERATIONS; i++) {
+            x0 = x0 * mul + add;
+            x1 = x1 * mul + add;
+            x2 = x2 * mul + add;
+            x3 = x3 * mul + add;
+            x4 = x4 * mul + add;
+            x5 = x5 * mul + add;
+            x6 = x6 * mul + add;
+            x7 = x7 * mul + add;
+        }
+
+        v4d sum = ((x0 + x1) + (x2 + x3)) + ((x4 + x5) + (x6 + x7));
+        checksum += sum[0] + sum[1] + sum[2] + sum[3];
+    }
+
+    unsigned long long tsc_end = __rdtsc();
+    double flop_time = omp_get_wtime() - flop_start_time;
+
+    double flops_per_thread = (double) FLOP_ITERATIONS * CHAINS * 4 * 2;
+    double gflops = flops_per_thread * num_threads / flop_time / 1e9;
+    double flops_per_cycle = flops_per_thread / (tsc_end - tsc_start);
+
+    flop_sink = checksum;
+
+    printf("%d,%f,%f,%f,%f,%f,%f,%f,%f\n", num_threads, bandwidth[0], bandwidth[1], bandwidth[2],
+           bandwidth[3], bandwidth[4], bandwidth[5], gflops, flops_per_cycle);
+
+    free(a);
+    free(b);
+    free(c);
+
+    return 0;
+}
@@ -4,12 +4,33 @@
 #include <time.h>
 #include <limits.h>
 #include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <string.h>
 #include <vector>
 #include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
+// mode flags
+#define MODE_FUSED 1
+#define MODE_SIMD 2
+
+// keys generated and distributed at once in fused mode (16 KiB - stays in L1/L2 until it is scattered)
+#define FUSED_BLOCK 4096
+
+// ints in one cache line (size of write combining buffer of one bucket)
+#define WC_LINE 16
+
+// write combining buffers are used up to this number of buckets (16384 * 64 B = 1 MiB per thread)
+#define WC_MAX_BUCKETS 16384
+
 int compare(const void *a, const void *b) {
     return (*(int *)a - *(int *)b);
 }
@@ -29,6 +50,27 @@ Bucket Sort Algorithm 3.
   3.6) Each thread rewrites its own sorted bucket to the array. Parallelized. Calculated times.
 4) Print time of each part.
 
+Fused mode (mode & MODE_FUSED):
+  Steps 2) and 3.2) are done together - each thread generates (or reads) FUSED_BLOCK keys of its part
+  and distributes them into its buckets right away, while the block is still in cache. Array is not written
+  until rewrite step. Fill, distribute and merge are reported as one (fused) phase.
+  Array is first touched in rewrite step, so its page faults move from fill to rewrite - compare the fused phase
+  with fill + distribute, and the total time, not rewrite times of the two modes.
+
+SIMD mode (mode & MODE_SIMD):
+  Step 3.2) computes bucket ids without division (multiply by precomputed reciprocal and shift), 8 keys at once
+  with AVX2. Each thread collects keys of every bucket in a cache line sized buffer and moves only full lines
+  into bucket storage (with non-temporal stores). Bucket storage is sized before scattering - by histogram
+  of the thread's part of array, or in fused mode by a bound for uniform keys (keys above it go to bucket data).
+
+Keys are random by default, optional input file is read as raw ints (at least <size> of them). Keys of the file
+must be in [0, INT_MAX] like the random ones (bucket id is key / (INT_MAX / buckets)) - file with a negative key
+is rejected.
+
+With PEAK_BW set, each phase is also reported as bandwidth (GB/s) and fraction of PEAK_BW, from minimum traffic of
+the phase: fill writes keys (4 B per key), distribute reads keys and writes thread buckets, merge reads them and
+writes concatenated buckets (16 B, 12 B fused without array), sort and rewrite read and write each key once (8 B).
+
 */
 
 
@@ -38,10 +80,284 @@ struct bucket {
 };
 
 
+/*
+    x / divisor == (x * multiplier) >> shift for 0 <= x <= INT_MAX.
+    shift = 31 + ceil(log2(divisor)), multiplier = ceil(2^shift / divisor) - always fits in 32 bits.
+*/
+struct reciprocal {
+    uint32_t multiplier;
+    int shift;
+};
+
+reciprocal make_reciprocal(uint32_t divisor) {
+    int log = 0;
+    while ((1ULL << log) < divisor) log++;
+
+    reciprocal r;
+    r.shift = 31 + log;
+    r.multiplier = (uint32_t)(((1ULL << r.shift) + divisor - 1) / divisor);
+    return r;
+}
+
+
+/*
+    Per thread state of distribute step.
+    With write combining buffers, keys of all buckets of the thread are stored in one cache line aligned block
+    (storage), bucket regions are sized before scattering (scatter_count / scatter_reserve, then scatter_alloc),
+    so full lines are streamed to their final place. Keys not fitting into the region go to bucket data.
+    Merge takes region of the bucket (scatter_region) first, then bucket data.
+*/
+struct scatter_state {
+    int mode;
+    int n_buckets;
+    reciprocal divisor;
+    int (*lines)[WC_LINE];  // write combining buffers (NULL if not used)
+    int *line_fill;
+    int *capacity;          // region size of every bucket
+    size_t *region_begin;   // region offset in storage of every bucket
+    int *region_used;
+    int *storage;
+};
+
+
+// read keys [offset, offset + n) from input file
+void read_keys(int fd, int *keys, long offset, int n) {
+    ssize_t bytes = pread(fd, keys, n * sizeof(int), offset * sizeof(int));
+    if (bytes != (ssize_t)(n * sizeof(int))) {
+        printf("Failed to read keys from input file\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (keys[i] < 0) {
+            printf("Negative key %d at index %ld of input file\n", keys[i], offset + i);
+            exit(1);
+        }
+    }
+}
+
+
+void scatter_init(scatter_state *state, int mode, int n_buckets) {
+    state->mode = mode;
+    state->n_buckets = n_buckets;
+    state->divisor = make_reciprocal(INT_MAX / n_buckets);
+    state->lines = NULL;
+    state->line_fill = NULL;
+    state->capacity = NULL;
+    state->region_begin = NULL;
+    state->region_used = NULL;
+    state->storage = NULL;
+
+    if ((mode & MODE_SIMD) && n_buckets <= WC_MAX_BUCKETS) {
+        if (posix_memalign((void **) &state->lines, 64, n_buckets * sizeof(*state->lines)) != 0) {
+            printf("Failed to allocate write combining buffers\n");
+            exit(1);
+        }
+        state->line_fill = (int *) calloc(n_buckets, sizeof(int));
+        state->capacity = (int *) calloc(n_buckets, sizeof(int));
+        state->region_begin = (size_t *) malloc(n_buckets * sizeof(size_t));
+        state->region_used = (int *) calloc(n_buckets, sizeof(int));
+    }
+}
+
+
+// bucket ids of n keys (multiply by reciprocal and shift, 8 keys at once with AVX2)
+void classify_keys(const int *keys, int n, int *bucket_ids, const scatter_state *state) {
+    uint64_t multiplier = state->divisor.multiplier;
+    int shift = state->divisor.shift;
+    int last = state->n_buckets - 1;
+    int i = 0;
+
+#ifdef __AVX2__
+    const __m256i v_multiplier = _mm256_set1_epi64x(multiplier);
+    const __m128i v_shift = _mm_cvtsi32_si128(shift);
+    const __m256i v_last = _mm256_set1_epi32(last);
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v_keys = _mm256_loadu_si256((const __m256i *) (keys + i));
+
+        // 32 x 32 -> 64 bit products of even and odd lanes, quotient ends up in low half of each 64 bit lane
+        __m256i even = _mm256_srl_epi64(_mm256_mul_epu32(v_keys, v_multiplier), v_shift);
+        __m256i odd = _mm256_srl_epi64(_mm256_mul_epu32(_mm256_srli_epi64(v_keys, 32), v_multiplier), v_shift);
+        __m256i ids = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+
+        _mm256_storeu_si256((__m256i *) (bucket_ids + i), _mm256_min_epi32(ids, v_last));
+    }
+#endif
+
+    for (; i < n; i++) {
+        bucket_ids[i] = MIN((int)(((uint64_t) keys[i] * multiplier) >> shift), last);
+    }
+}
+
+
+// exact region sizes - histogram of keys that will be scattered
+void scatter_count(scatter_state *state, const int *keys, int n) {
+    if (state->lines == NULL)
+        return;
+
+    int bucket_ids[FUSED_BLOCK];
+
+    for (int i = 0; i < n; i += FUSED_BLOCK) {
+        int block_size = MIN(FUSED_BLOCK, n - i);
+        classify_keys(keys + i, block_size, bucket_ids, state);
+
+        for (int k = 0; k < block_size; k++) {
+            state->capacity[bucket_ids[k]]++;
+        }
+    }
+}
+
+
+// region sizes bound for n uniformly distributed keys (mean + 6 standard deviations), when keys are not known ahead
+void scatter_reserve(scatter_state *state, int n) {
+    if (state->lines == NULL)
+        return;
+
+    double mean = (double) n / state->n_buckets;
+    int bound = (int) (mean + 6.0 * sqrt(mean)) + 1;
+
+    for (int bucket_id = 0; bucket_id < state->n_buckets; bucket_id++) {
+        state->capacity[bucket_id] = bound;
+    }
+}
+
+
+// allocate regions (every one starts at cache line)
+void scatter_alloc(scatter_state *state) {
+    if (state->lines == NULL)
+        return;
+
+    size_t total = 0;
+    for (int bucket_id = 0; bucket_id < state->n_buckets; bucket_id++) {
+        state->capacity[bucket_id] = (state->capacity[bucket_id] + WC_LINE - 1) / WC_LINE * WC_LINE;
+        state->region_begin[bucket_id] = total;
+        total += state->capacity[bucket_id];
+    }
+
+    if (posix_memalign((void **) &state->storage, 64, MAX(total, 1) * sizeof(int)) != 0) {
+        printf("Failed to allocate bucket storage\n");
+        exit(1);
+    }
+}
+
+
+// move full line from write combining buffer to bucket region (aligned append), or to data if region is full
+inline void flush_line(scatter_state *state, bucket *b, int bucket_id, const int *line) {
+    int used = state->region_used[bucket_id];
+    if (used + WC_LINE > state->capacity[bucket_id]) {
+        b->data.insert(b->data.end(), line, line + WC_LINE);
+        return;
+    }
+
+    int *dst = state->storage + state->region_begin[bucket_id] + used;
+    state->region_used[bucket_id] = used + WC_LINE;
+
+#ifdef __AVX2__
+    _mm256_stream_si256((__m256i *) dst, _mm256_load_si256((const __m256i *) line));
+    _mm256_stream_si256((__m256i *) (dst + 8), _mm256_load_si256((const __m256i *) (line + 8)));
+#else
+    memcpy(dst, line, WC_LINE * sizeof(int));
+#endif
+}
+
+
+inline void scatter_key(scatter_state *state, bucket **buckets, int bucket_id, int key) {
+    if (state->lines == NULL) {
+        buckets[bucket_id]->data.push_back(key);
+        return;
+    }
+
+    int fill = state->line_fill[bucket_id];
+    state->lines[bucket_id][fill++] = key;
+
+    if (fill == WC_LINE) {
+        flush_line(state, buckets[bucket_id], bucket_id, state->lines[bucket_id]);
+        fill = 0;
+    }
+
+    state->line_fill[bucket_id] = fill;
+}
+
+
+// put keys into thread buckets
+void distribute_keys(const int *keys, int n, bucket **buckets, scatter_state *state) {
+    int n_buckets = state->n_buckets;
+
+    if (!(state->mode & MODE_SIMD)) {
+        for (int i = 0; i < n; i++) {
+            int bucket_id = MIN((keys[i] / (INT_MAX / n_buckets)), n_buckets - 1); // min to put numbers meeting (INT_MAX % num_threads) to the last bucket
+            buckets[bucket_id]->data.push_back(keys[i]); // put into bucket
+        }
+        return;
+    }
+
+    int bucket_ids[FUSED_BLOCK];
+
+    for (int i = 0; i < n; i += FUSED_BLOCK) {
+        int block_size = MIN(FUSED_BLOCK, n - i);
+        classify_keys(keys + i, block_size, bucket_ids, state);
+
+        for (int k = 0; k < block_size; k++) {
+            scatter_key(state, buckets, bucket_ids[k], keys[i + k]);
+        }
+    }
+}
+
+
+// move partially filled write combining buffers to buckets
+void scatter_finish(scatter_state *state, bucket **buckets) {
+    if (state->lines == NULL)
+        return;
+
+    for (int bucket_id = 0; bucket_id < state->n_buckets; bucket_id++) {
+        int *line = state->lines[bucket_id];
+        int fill = state->line_fill[bucket_id];
+        int used = state->region_used[bucket_id];
+
+        if (used + fill <= state->capacity[bucket_id]) {
+            memcpy(state->storage + state->region_begin[bucket_id] + used, line, fill * sizeof(int));
+            state->region_used[bucket_id] = used + fill;
+        } else {
+            buckets[bucket_id]->data.insert(buckets[bucket_id]->data.end(), line, line + fill);
+        }
+    }
+
+#ifdef __AVX2__
+    // make streamed lines visible to other threads
+    _mm_sfence();
+#endif
+
+    free(state->lines);
+    free(state->line_fill);
+    free(state->capacity);
+}
+
+
+// keys of bucket stored in its region (NULL / 0 without write combining buffers)
+int scatter_region(const scatter_state *state, int bucket_id, const int **keys) {
+    if (state->storage == NULL) {
+        *keys = NULL;
+        return 0;
+    }
+
+    *keys = state->storage + state->region_begin[bucket_id];
+    return state->region_used[bucket_id];
+}
+
+
+// free bucket regions (after merge)
+void scatter_free(scatter_state *state) {
+    free(state->region_begin);
+    free(state->region_used);
+    free(state->storage);
+}
+
+
 int main(int argc, char *argv[]) {
 
-    if (argc != 4) {
-        printf("Usage: %s <size> <buckets> <threads>\n", argv[0]);
+    if (argc < 4 || argc > 6) {
+        printf("Usage: %s <size> <buckets> <threads> [mode] [input_file]\n", argv[0]);
         exit(1);
     }
 
@@ -50,6 +366,19 @@ int main(int argc, char *argv[]) {
     int n_buckets = atoi(argv[2]);
     int num_threads = atoi(argv[3]);
     // int num_threads = omp_get_max_threads();
+    int mode = argc > 4 ? atoi(argv[4]) : 0;
+
+    // --- input file ---
+    int input_fd = -1;
+    if (argc > 5) {
+        input_fd = open(argv[5], O_RDONLY);
+
+        struct stat input_stat;
+        if (input_fd < 0 || fstat(input_fd, &input_stat) != 0 || input_stat.st_size < (off_t)size * (off_t)sizeof(int)) {
+            printf("Input file %s must contain at least %d ints\n", argv[5], size);
+            exit(1);
+        }
+    }
 
     omp_set_num_threads(num_threads);
 
@@ -76,6 +405,9 @@ int main(int argc, char *argv[]) {
         concatenated_buckets[i] = new bucket;
     }
 
+    // distribute step state of each thread (bucket regions live until merge is done)
+    scatter_state *scatter_states = new scatter_state[num_threads];
+
 
     // random seed
     int tid;
@@ -84,41 +416,98 @@ int main(int argc, char *argv[]) {
 
     double alg_start_time = omp_get_wtime();
 
-    // --- fill array step ---
     double random_start_time = omp_get_wtime();
+    double random_end_time = random_start_time;
+    double distrb_start_time = random_start_time;
+
+    if (mode & MODE_FUSED) {
+        // --- fused fill and distribute step ---
+
+        #pragma omp parallel private(tid, xsubi) shared(thread_buckets, size)
+        {
+            tid = omp_get_thread_num();
+            xsubi[0] = xsubi[1] = xsubi[2] = tid + 3;
+
+            int block[FUSED_BLOCK];
+
+            int base_job_size = size / num_threads;
+            int job_size = base_job_size;
+            if (omp_get_thread_num() == num_threads - 1)
+                job_size += size % num_threads;
+
+            // keys are not known before they are generated - regions sized by bound
+            scatter_state *state = &scatter_states[tid];
+            scatter_init(state, mode, n_buckets);
+            scatter_reserve(state, job_size);
+            scatter_alloc(state);
+
+            for (int i = tid * base_job_size; i < tid * base_job_size + job_size; i += FUSED_BLOCK) {
+                int block_size = MIN(FUSED_BLOCK, tid * base_job_size + job_size - i);
+
+                if (input_fd >= 0) {
+                    read_keys(input_fd, block, i, block_size);
+                } else {
+                    for (int k = 0; k < block_size; k++) {
+                        block[k] = (int)(nrand48(xsubi));
+                    }
+                }
+
+                distribute_keys(block, block_size, thread_buckets[tid], state);
+            }
 
-    #pragma omp parallel private(tid, xsubi) shared(a, size)
-    {
-        tid = omp_get_thread_num();
-        xsubi[0] = xsubi[1] = xsubi[2] = tid + 3;
+            scatter_finish(state, thread_buckets[tid]);
 
-        #pragma omp for
-        for (int i = 0; i < size; i++) {
-            a[i] = (int)(nrand48(xsubi));
         }
 
-    }
+    } else {
+        // --- fill array step ---
+
+        #pragma omp parallel private(tid, xsubi) shared(a, size)
+        {
+            tid = omp_get_thread_num();
+            xsubi[0] = xsubi[1] = xsubi[2] = tid + 3;
+
+            if (input_fd >= 0) {
+                int base_job_size = size / num_threads;
+                int job_size = base_job_size;
+                if (omp_get_thread_num() == num_threads - 1)
+                    job_size += size % num_threads;
+
+                read_keys(input_fd, a + tid * base_job_size, tid * base_job_size, job_size);
+            } else {
+                #pragma omp for
+                for (int i = 0; i < size; i++) {
+                    a[i] = (int)(nrand48(xsubi));
+                }
+            }
+
+        }
 
-    double random_end_time = omp_get_wtime();
+        random_end_time = omp_get_wtime();
 
 
-    // --- distribute into buckets step ---
-    double distrb_start_time = omp_get_wtime();
+        // --- distribute into buckets step ---
+        distrb_start_time = omp_get_wtime();
 
-    #pragma omp parallel private(tid) shared(a, thread_buckets, size)
-    {
-        tid = omp_get_thread_num();
-        
-        int base_job_size = size / num_threads;
-        int job_size = base_job_size;
-        if (omp_get_thread_num() == num_threads - 1)
-            job_size += size % num_threads;
-        
-        for (int i = tid * base_job_size; i < tid * base_job_size + job_size; i++) {
-            int bucket_id = MIN((a[i] / (INT_MAX / n_buckets)), n_buckets - 1); // min to put numbers meeting (INT_MAX % num_threads) to the last bucket
-            thread_buckets[tid][bucket_id]->data.push_back(a[i]); // put into bucket
-        }
+        #pragma omp parallel private(tid) shared(a, thread_buckets, size)
+        {
+            tid = omp_get_thread_num();
 
+            int base_job_size = size / num_threads;
+            int job_size = base_job_size;
+            if (omp_get_thread_num() == num_threads - 1)
+                job_size += size % num_threads;
+
+            scatter_state *state = &scatter_states[tid];
+            scatter_init(state, mode, n_buckets);
+            scatter_count(state, a + tid * base_job_size, job_size);
+            scatter_alloc(state);
+
+            distribute_keys(a + tid * base_job_size, job_size, thread_buckets[tid], state);
+
+            scatter_finish(state, thread_buckets[tid]);
+
+        }
     }
 
     // // print buckets
@@ -137,18 +526,24 @@ int main(int argc, char *argv[]) {
 
     // --- merge buckets step ---
 
-    #pragma omp parallel for shared(thread_buckets, concatenated_buckets)
+    #pragma omp parallel for shared(thread_buckets, concatenated_buckets, scatter_states)
     for (int bucket_id = 0; bucket_id < n_buckets; bucket_id++){
         
         int conc_size = 0;
         for (int thread_id = 0; thread_id < num_threads; thread_id++){
-            conc_size += thread_buckets[thread_id][bucket_id]->data.size();
+            const int *region;
+            conc_size += scatter_region(&scatter_states[thread_id], bucket_id, &region) + thread_buckets[thread_id][bucket_id]->data.size();
         }
 
         concatenated_buckets[bucket_id]->size = conc_size;
         
         // concatenate buckets
         for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+            const int *region;
+            int region_size = scatter_region(&scatter_states[thread_id], bucket_id, &region);
+            if (region_size > 0)
+                concatenated_buckets[bucket_id]->data.insert(concatenated_buckets[bucket_id]->data.end(), region, region + region_size);
+
             for (int k = 0; k < thread_buckets[thread_id][bucket_id]->data.size(); k++) {
                 concatenated_buckets[bucket_id]->data.push_back(thread_buckets[thread_id][bucket_id]->data[k]);
             }
@@ -232,18 +627,59 @@ int main(int argc, char *argv[]) {
 
     free(thread_buckets);
 
+    for (int i = 0; i < num_threads; i++) {
+        scatter_free(&scatter_states[i]);
+    }
+
+    delete[] scatter_states;
+
 
     // --- deallocate memory ---
     free(a);
 
+    if (input_fd >= 0)
+        close(input_fd);
+
     for (int i = 0; i < n_buckets; i++) {
         delete concatenated_buckets[i];
     }
 
     free(concatenated_buckets);
 
-    // --- print times --- (fill, distribute, sort, rewrite, all)
-    printf("%f,%f,%f,%f,%f", random_end_time - random_start_time, distrb_stop_time - distrb_start_time, sort_stop_time - sort_start_time, rewrite_stop_time - rewrite_start_time, alg_stop_time - alg_start_time);
+    // --- phase times and minimum memory traffic (bytes per key) ---
+    double times[5];
+    double bytes_per_key[5];
+    int n_phases;
+
+    if (mode & MODE_FUSED) {
+        // fused, sort, rewrite, all
+        double phase_times[] = {distrb_stop_time - random_start_time, sort_stop_time - sort_start_time, rewrite_stop_time - rewrite_start_time, alg_stop_time - alg_start_time};
+        double phase_bytes[] = {12, 8, 8, 28};
+        n_phases = 4;
+        std::copy(phase_times, phase_times + n_phases, times);
+        std::copy(phase_bytes, phase_bytes + n_phases, bytes_per_key);
+    } else {
+        // fill, distribute, sort, rewrite, all
+        double phase_times[] = {random_end_time - random_start_time, distrb_stop_time - distrb_start_time, sort_stop_time - sort_start_time, rewrite_stop_time - rewrite_start_time, alg_stop_time - alg_start_time};
+        double phase_bytes[] = {4, 16, 8, 8, 36};
+        n_phases = 5;
+        std::copy(phase_times, phase_times + n_phases, times);
+        std::copy(phase_bytes, phase_bytes + n_phases, bytes_per_key);
+    }
+
+    // --- print times ---
+    for (int i = 0; i < n_phases; i++) {
+        printf(i == 0 ? "%f" : ",%f", times[i]);
+    }
+
+    // --- print bandwidth of each phase and its fraction of peak (PEAK_BW in GB/s, measured by ../lab4/stream) ---
+    const char *peak_bw = getenv("PEAK_BW");
+    if (peak_bw != NULL) {
+        for (int i = 0; i < n_phases; i++) {
+            double bandwidth = bytes_per_key[i] * size / times[i] / 1e9;
+            printf(",%f,%f", bandwidth, bandwidth / atof(peak_bw));
+        }
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,8 +1,35 @@
 #!/bin/bash
 
-echo "size,bucket,threads,fill,distrib,sort,rewrite,all" > "output.csv"
+# mode flags: 1 - fused fill and distribute, 2 - SIMD classification with write combining buffers
+mode=${1:-0}
 
-g++ bucket.cpp -o bucket -fopenmp
+suffix=""
+phases="fill distrib sort rewrite all"
+if (( mode & 1 )); then
+    suffix+="f"
+    phases="fused sort rewrite all"
+fi
+if (( mode & 2 )); then
+    suffix+="v"
+fi
+output="output${suffix:+_$suffix}.csv"
+
+# times, then bandwidth (GB/s) and fraction of peak bandwidth of every phase
+header="size,bucket,threads,${phases// /,}"
+for phase in $phases; do
+    header+=",${phase}_bw,${phase}_frac"
+done
+
+echo $header > $output
+
+# peak bandwidth (best of STREAM triad with regular and non-temporal stores) for every number of threads
+gcc -O2 -march=native ../lab4/stream.c -o stream -fopenmp
+declare -A peak_bw
+for threads in 1 2 3 4 5 6 7 8; do
+    peak_bw[$threads]=$(./stream 20000000 $threads | awk -F, '{ print ($4 > $7 ? $4 : $7) }')
+done
+
+g++ -O2 -march=native bucket.cpp -o bucket -fopenmp
 for size in 5000000 10000000 15000000; do
 
     for bucket_size in 0 1 2; do
@@ -21,7 +48,7 @@ for size in 5000000 10000000 15000000; do
             esac
 
             echo "run for size: " $size ", bucket size: " $bucket_real " and threads: " $threads
-            printf "%d,%d,%d,%s\n" $size $bucket_real $threads $(OMP_DYNAMIC=false ./bucket $size $bucket_real $threads) >> "output.csv";
+            printf "%d,%d,%d,%s\n" $size $bucket_real $threads $(PEAK_BW=${peak_bw[$threads]} OMP_DYNAMIC=false ./bucket $size $bucket_real $threads $mode) >> $output;
         done
     done
 done